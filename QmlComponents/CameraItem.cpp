@@ -3,6 +3,7 @@
 #include <assert.h>
 #include <thread>
 #include <queue>
+#include <algorithm>
 
 #include <QSGGeometryNode>
 #include <QSGGeometry>
@@ -28,6 +29,16 @@ const int kEyePercentHeight = 25;
 const int kEyePercentWidth = 35;
 const bool kSmoothFaceImage = false;
 const float kSmoothFaceFactor = 0.005;
+// face sizes are in full resolution pixels, smallImg sees them divided by the detection scale
+const int kMinFaceSize = 150;
+const int kMaxFaceSize = 300;
+// matches the largest reduced JPEG decode, beyond it smallImg gets too small to hold a face
+const double kMaxDetectionScale = 8.0;
+const double kMotionThumbnailScale = 0.125;
+const int kMotionBlockSize = 8;
+const double kMotionBlockThreshold = 10.0;
+const double kMotionFullFrameRatio = 0.5;
+const int kMotionRefreshInterval = 30;
 
 using namespace cv;
 
@@ -36,23 +47,43 @@ CameraItem::CameraItem()
     , videoWidth(this, &CameraItem::videoWidthChanged, 640)
     , videoHeight(this, &CameraItem::videoHeightChanged, 480)
     , cameraInterface(this, &CameraItem::cameraInterfaceChanged, 0)
+    , videoSource(this, &CameraItem::videoSourceChanged, QString())
+    , detectionScale(this, &CameraItem::detectionScaleChanged, 1.0)
     , firstCascadeSource(this, &CameraItem::firstCascadeSourceChanged, ":/cascades/haarcascade_frontalface_alt.xml")
     , secondCascadeSource(this, &CameraItem::secondCascadeSourceChanged, ":/cascades/haarcascade_eye.xml")
+    , tiledDetection(this, &CameraItem::tiledDetectionChanged, false)
     , m_Done(false)
+    , m_Displayed(true)
     , m_FacePos()
+    , m_FramesSinceFullDetection(0)
 {
     ocl::setUseOpenCL(true);
 
-    m_Capture.set(CV_CAP_PROP_FPS, frameRate);
-    m_Capture.set(CV_CAP_PROP_FRAME_WIDTH, videoWidth);
-    m_Capture.set(CV_CAP_PROP_FRAME_HEIGHT, videoHeight);
-
     bool connected = connect(this, &CameraItem::capturedImage, this, &CameraItem::setImage, Qt::QueuedConnection);
     assert(connected);
 
+    // hidden items don't need the full colour decode
+    connected = connect(this, &QQuickItem::visibleChanged, this, [this] { m_Displayed = isVisible(); });
+    assert(connected);
+
+    // the pipeline only ever sees properties through m_Config
+    for (auto changed : {&CameraItem::frameRateChanged,
+                         &CameraItem::videoWidthChanged,
+                         &CameraItem::videoHeightChanged,
+                         &CameraItem::cameraInterfaceChanged,
+                         &CameraItem::videoSourceChanged,
+                         &CameraItem::detectionScaleChanged,
+                         &CameraItem::firstCascadeSourceChanged,
+                         &CameraItem::secondCascadeSourceChanged,
+                         &CameraItem::tiledDetectionChanged})
+    {
+        connected = connect(this, changed, this, &CameraItem::_publishConfig) && connected;
+    }
+    assert(connected);
+
     Q_UNUSED(connected);
 
-    _init();
+    _publishConfig();
 
     setFlag(ItemHasContents, true);
 }
@@ -118,19 +149,26 @@ QSGNode* CameraItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *)
     return resultTexture;
 }
 
-void CameraItem::_init()
+void CameraItem::componentComplete()
 {
-    if(!m_Capture.open(cameraInterface))
-    {
-        qDebug()<<"Can't open camera interface: "<<cameraInterface;
-        assert(true);
-    }
+    QQuickItem::componentComplete();
+
+    // an item declared invisible never emits visibleChanged, so pick the state up before starting
+    m_Displayed = isVisible();
+
+    // start once QML has assigned the properties, later changes arrive through m_Config
+    _init();
+}
 
-    if (!_loadCascade(m_FirstCascade, firstCascadeSource) || !_loadCascade(m_SecondCascade, secondCascadeSource))
+void CameraItem::_init()
+{
+    if (!_loadCascade(m_FirstCascade, firstCascadeSource, &m_TiledCascade) || !_loadCascade(m_SecondCascade, secondCascadeSource))
     {
         qDebug()<<"Failed to load cascades";
         return;
     }
+    m_FirstCascadeSource = firstCascadeSource;
+    m_SecondCascadeSource = secondCascadeSource;
 
 
     m_GuiQueue.set_capacity(2);
@@ -140,11 +178,29 @@ void CameraItem::_init()
                                              std::ref(m_GuiQueue),
                                              std::ref(m_FirstCascade),
                                              std::ref(m_SecondCascade),
-                                             1,
                                              true);
 }
 
-bool CameraItem::_loadCascade(CameraItem::Cascade &cascade, QString url)
+bool CameraItem::_openCapture(MjpegCapture &capture, const PipelineConfig &config)
+{
+    if (config.videoSource.isEmpty())
+    {
+        if(!capture.open(config.cameraInterface))
+        {
+            qDebug()<<"Can't open camera interface: "<<config.cameraInterface;
+            return false;
+        }
+    }
+    else if (!capture.open(config.videoSource.toStdString()))
+    {
+        qDebug()<<"Can't open video source: "<<config.videoSource;
+        return false;
+    }
+
+    return true;
+}
+
+bool CameraItem::_loadCascade(CameraItem::Cascade &cascade, QString url, TiledCascade *tiledCascade)
 {
     QFile file(url);
     if (!file.open(QIODevice::ReadOnly))
@@ -166,14 +222,19 @@ bool CameraItem::_loadCascade(CameraItem::Cascade &cascade, QString url)
         return false;
     }
 
+    // parsed once here, tile workers only read their copies from it
+    if (tiledCascade && !tiledCascade->load(output.fileName().toStdString()))
+    {
+        qDebug()<<"Can't prepare tiled cascade, falling back to full-frame detection: "<<url;
+    }
+
     return true;
 }
 
-void CameraItem::_detectAndDrawTBB(VideoCapture &capture,
+void CameraItem::_detectAndDrawTBB(MjpegCapture &capture,
                                   CameraItem::Concurent_queue &guiQueue,
                                   CameraItem::Cascade &cascade,
                                   CameraItem::Cascade &nestedCascade,
-                                  double scale,
                                   bool tryFlip)
 {
     const static Scalar colors[] =
@@ -188,14 +249,103 @@ void CameraItem::_detectAndDrawTBB(VideoCapture &capture,
             Scalar(255,0,255)
         };
 
+    AtomicSnapshot<PipelineConfig>::Reader config(m_Config);
+    std::shared_ptr<const PipelineConfig> appliedConfig;
+    bool annotationsStale = false;
+
+    // the tiled cascade is only reloaded in the serial detection stage, while no tile worker is running
+    auto reloadCascade = [this](Cascade& target, QString& loadedSource, const QString& source,
+                                TiledCascade* tiledCascade)
+    {
+        if (source == loadedSource)
+        {
+            return false;
+        }
+
+        // keep the old cascade if the new one doesn't load, and don't retry every frame
+        loadedSource = source;
+        Cascade reloaded;
+        if (!_loadCascade(reloaded, source, tiledCascade))
+        {
+            return false;
+        }
+        target = reloaded;
+        return true;
+    };
+
+    auto detectFaces = [&](const PipelineConfig& frameConfig, const Mat& img, std::vector<Rect>& objects)
+    {
+        const int minFaceSize = cvRound(kMinFaceSize / frameConfig.detectionScale);
+        if (frameConfig.tiledDetection && !m_TiledCascade.empty())
+        {
+            const int maxFaceSize = cvRound(kMaxFaceSize / frameConfig.detectionScale);
+            m_TiledCascade.detectMultiScale(img, objects, 1.05, 3,
+                                            Size(minFaceSize, minFaceSize),
+                                            Size(maxFaceSize, maxFaceSize));
+        }
+        else
+        {
+            cascade.detectMultiScale(img, objects,
+                                     1.05, 3, 0 | CASCADE_SCALE_IMAGE,
+                                     Size(minFaceSize, minFaceSize));
+        }
+    };
+
     tbb::parallel_pipeline(7,
                            tbb::make_filter<void, ProcessingChainData *>(tbb::filter::serial_in_order,
                                                                          [&](tbb::flow_control& fc)->ProcessingChainData*
     {
 
         auto pData = new ProcessingChainData();
-        capture >> pData->image;
-        if (m_Done || pData->image.empty())
+        pData->config = config.get();
+
+        const bool reopen = !appliedConfig
+                || appliedConfig->cameraInterface != pData->config->cameraInterface
+                || appliedConfig->videoSource != pData->config->videoSource;
+        if (reopen)
+        {
+            _openCapture(capture, *pData->config);
+        }
+
+        if (reopen || appliedConfig->frameRate != pData->config->frameRate)
+        {
+            capture.set(CV_CAP_PROP_FPS, pData->config->frameRate);
+        }
+        if (reopen
+                || appliedConfig->videoWidth != pData->config->videoWidth
+                || appliedConfig->videoHeight != pData->config->videoHeight)
+        {
+            capture.set(CV_CAP_PROP_FRAME_WIDTH, pData->config->videoWidth);
+            capture.set(CV_CAP_PROP_FRAME_HEIGHT, pData->config->videoHeight);
+        }
+        appliedConfig = pData->config;
+
+        // detection only needs luma at the reduced size. Without a reduction a shown frame is
+        // decoded once in colour and converted like an uncompressed one. Undecodable frames are skipped.
+        const int decodeReduction = MjpegCapture::reductionFor(pData->config->detectionScale);
+        pData->display = m_Displayed;
+        const bool decodeColorOnly = decodeReduction == 1 && pData->display;
+        Mat frame;
+        bool captured = false;
+        do
+        {
+            captured = capture.read(frame);
+        }
+        while (captured && !m_Done && MjpegCapture::isJpeg(frame)
+               && !(decodeColorOnly ? MjpegCapture::decodeColor(frame, pData->image)
+                                    : MjpegCapture::decodeLuma(frame, decodeReduction, pData->gray)));
+
+        if (MjpegCapture::isJpeg(frame))
+        {
+            pData->compressed = frame;
+            pData->decodeReduction = decodeReduction;
+        }
+        else
+        {
+            pData->image = frame;
+        }
+
+        if (m_Done || !captured || frame.empty())
         {
             delete pData;
             m_Done = true;
@@ -209,14 +359,22 @@ void CameraItem::_detectAndDrawTBB(VideoCapture &capture,
     tbb::make_filter<ProcessingChainData*, ProcessingChainData *>(tbb::filter::serial_in_order,
                                            [&](ProcessingChainData *pData)->ProcessingChainData*
     {
-        cvtColor(pData->image, pData->gray, COLOR_BGR2GRAY);
+        if (pData->gray.empty())
+        {
+            cvtColor(pData->image, pData->gray, COLOR_BGR2GRAY);
+        }
+        else if (pData->display)
+        {
+            // full resolution colour is only decoded for frames the GUI will show
+            pData->display = MjpegCapture::decodeColor(pData->compressed, pData->image);
+        }
         return pData;
     }
     )&
     tbb::make_filter<ProcessingChainData*, ProcessingChainData *>(tbb::filter::serial_in_order,
                                            [&](ProcessingChainData* pData)->ProcessingChainData*
     {
-        double fx = 1 / scale;
+        double fx = pData->decodeReduction / pData->config->detectionScale;
         resize(pData->gray, pData->smallImg, Size(), fx, fx, INTER_LINEAR);
         return pData;
     }
@@ -224,16 +382,98 @@ void CameraItem::_detectAndDrawTBB(VideoCapture &capture,
     tbb::make_filter<ProcessingChainData*, ProcessingChainData*>(tbb::filter::serial_in_order,
                                            [&](ProcessingChainData* pData)->ProcessingChainData*
     {
-        equalizeHist(pData->smallImg, pData->smallImg);
+        pData->motion = _estimateMotion(pData->smallImg, pData->config->detectionScale, pData->changedRegions);
+        return pData;
+    }
+    )&
+    tbb::make_filter<ProcessingChainData*, ProcessingChainData*>(tbb::filter::serial_in_order,
+                                           [&](ProcessingChainData* pData)->ProcessingChainData*
+    {
+        if (pData->motion != MotionState::Static)
+        {
+            equalizeHist(pData->smallImg, pData->smallImg);
+        }
         return pData;
     }
     )&
     tbb::make_filter<ProcessingChainData*, ProcessingChainData*>(tbb::filter::serial_in_order,
                                            [&](ProcessingChainData* pData)->ProcessingChainData*
     {
-        cascade.detectMultiScale(pData->smallImg, pData->firstCascadeObjects,
-                                 1.05, 3, 0 | CASCADE_SCALE_IMAGE,
-                                 Size(150, 150));
+        bool firstReloaded = reloadCascade(cascade, m_FirstCascadeSource, pData->config->firstCascadeSource,
+                                           &m_TiledCascade);
+        reloadCascade(nestedCascade, m_SecondCascadeSource, pData->config->secondCascadeSource, nullptr);
+        if (firstReloaded)
+        {
+            // faces found by the previous cascade can't be reused
+            if (pData->motion == MotionState::Static)
+            {
+                equalizeHist(pData->smallImg, pData->smallImg);
+            }
+            pData->motion = MotionState::Full;
+        }
+
+        switch (pData->motion)
+        {
+        case MotionState::Static:
+            pData->firstCascadeObjects = m_LastFaces;
+            pData->reusedFaces = m_LastFaces;
+            break;
+
+        case MotionState::Partial:
+        {
+            // faces touching a changed region are re-detected there, the rest are kept.
+            // Growing a region can make it reach another face, so repeat until nothing grows.
+            std::vector<Rect> untouched = m_LastFaces;
+            bool grown = true;
+            while (grown)
+            {
+                grown = false;
+                for (auto face = untouched.begin(); face != untouched.end();)
+                {
+                    bool touched = false;
+                    for (Rect& region : pData->changedRegions)
+                    {
+                        if ((*face & region).area() > 0)
+                        {
+                            region |= *face;
+                            touched = true;
+                        }
+                    }
+
+                    if (touched)
+                    {
+                        face = untouched.erase(face);
+                        grown = true;
+                    }
+                    else
+                    {
+                        ++face;
+                    }
+                }
+                _mergeRegions(pData->changedRegions);
+            }
+
+            pData->firstCascadeObjects = untouched;
+            pData->reusedFaces = untouched;
+
+            for (const Rect& region : pData->changedRegions)
+            {
+                std::vector<Rect> found;
+                detectFaces(*pData->config, pData->smallImg(region), found);
+                for (const Rect& face : found)
+                {
+                    pData->firstCascadeObjects.push_back(face + region.tl());
+                }
+            }
+            break;
+        }
+
+        case MotionState::Full:
+            detectFaces(*pData->config, pData->smallImg, pData->firstCascadeObjects);
+            break;
+        }
+
+        m_LastFaces = pData->firstCascadeObjects;
 
 //        if (tryFlip)
 //        {
@@ -246,44 +486,83 @@ void CameraItem::_detectAndDrawTBB(VideoCapture &capture,
     tbb::make_filter<ProcessingChainData*, ProcessingChainData*>(tbb::filter::serial_in_order,
                                            [&](ProcessingChainData* pData)->ProcessingChainData*
     {
+        if (!pData->display)
+        {
+            annotationsStale = annotationsStale || pData->motion != MotionState::Static;
+            return pData;
+        }
+
+        std::vector<FaceAnnotation> annotations;
         if (!pData->firstCascadeObjects.empty())
         {
             for (size_t i = 0; i < pData->firstCascadeObjects.size(); ++i)
             {
-                m_FacePos = pData->firstCascadeObjects[i];
+                const Rect& detection = pData->firstCascadeObjects[i];
+
+                // faces in unchanged parts of the frame replay their previous box and pupil
+                auto cached = std::find_if(m_LastAnnotations.begin(), m_LastAnnotations.end(),
+                                           [&detection](const FaceAnnotation& annotation) { return annotation.detection == detection; });
+                if (!annotationsStale && cached != m_LastAnnotations.end()
+                        && std::find(pData->reusedFaces.begin(), pData->reusedFaces.end(), detection) != pData->reusedFaces.end())
+                {
+                    _drawAnnotation(pData->image, *cached);
+                    annotations.push_back(*cached);
+                    continue;
+                }
+
+                m_FacePos = detection;
 
                 Rect smoothedRect = _getSmoothed(m_FacePos);
+                const double scale = pData->config->detectionScale;
                 Scalar color = colors[i%8];
                 Rect faceRect = {cvPoint(cvRound(smoothedRect.x * scale), cvRound(smoothedRect.y * scale)),
                                      cvPoint(cvRound((smoothedRect.x + smoothedRect.width) * scale),
                                              cvRound((smoothedRect.y + smoothedRect.height) * scale))};
+                const Rect imageRect(0, 0, pData->image.cols, pData->image.rows);
+                faceRect &= imageRect;
 
                 rectangle(pData->image, faceRect, color, 3, 8, 0);
 
-                // draw eyes
+                // draw eyes, everything from here on is in full resolution image coordinates
                 int eye_region_width = faceRect.width * (kEyePercentWidth/100.0);
                 int eye_region_height = faceRect.width * (kEyePercentHeight/100.0);
                 int eye_region_top = faceRect.height * (kEyePercentTop/100.0);
-                Rect leftEyeRegion(smoothedRect.x + faceRect.width * (kEyePercentSide/100.0),
-                                       smoothedRect.y + eye_region_top, eye_region_width, eye_region_height);
-                Rect rightEyeRegion(smoothedRect.x + faceRect.width - eye_region_width - faceRect.width * (kEyePercentSide/100.0),
-                                        smoothedRect.y + eye_region_top, eye_region_width, eye_region_height);
+                int eye_region_side = faceRect.width * (kEyePercentSide/100.0);
+                Rect leftEyeRegion = Rect(faceRect.x + eye_region_side,
+                                          faceRect.y + eye_region_top, eye_region_width, eye_region_height) & imageRect;
+                Rect rightEyeRegion = Rect(faceRect.x + faceRect.width - eye_region_width - eye_region_side,
+                                           faceRect.y + eye_region_top, eye_region_width, eye_region_height) & imageRect;
 
                 rectangle(pData->image, leftEyeRegion, color, 3, 8, 0);
                 rectangle(pData->image, rightEyeRegion, color, 3, 8, 0);
 
-                Mat faceROI = pData->image(faceRect);
-                Point leftPupil = _getSmoothed(_findEyeCenter(pData->image, leftEyeRegion));
-//                qDebug()<<"leftPupil: "<<leftPupil.x<<", "<<leftPupil.y;
-                circle(pData->image, cvPoint(leftPupil.x + faceRect.x, leftPupil.y + faceRect.y + leftEyeRegion.height / 2), 3, 1234);
+                // _findEyeCenter returns the pupil relative to the eye region
+                Point leftPupil;
+                if (leftEyeRegion.width > 2 && leftEyeRegion.height > 2)
+                {
+                    leftPupil = _getSmoothed(_findEyeCenter(pData->image, leftEyeRegion)) + leftEyeRegion.tl();
+//                    qDebug()<<"leftPupil: "<<leftPupil.x<<", "<<leftPupil.y;
+                    circle(pData->image, leftPupil, 3, 1234);
+                }
+
+                annotations.push_back({detection, faceRect, leftEyeRegion, rightEyeRegion, leftPupil, color});
             }
         }
+
+        m_LastAnnotations.swap(annotations);
+        annotationsStale = false;
         return pData;
     }
     )&
     tbb::make_filter<ProcessingChainData*, void>(tbb::filter::serial_in_order,
                                            [&](ProcessingChainData *pData)
     {
+        if (!pData->display)
+        {
+            delete pData;
+            return;
+        }
+
         if (!m_Done)
         {
             try
@@ -327,6 +606,102 @@ Rect CameraItem::_getSmoothed(const Rect& point)
     return Rect(x / listSize, y / listSize, w / listSize, h / listSize);
 }
 
+CameraItem::MotionState CameraItem::_estimateMotion(const Mat &smallImg, double scale, std::vector<Rect> &changedRegions)
+{
+    Mat thumbnail;
+    resize(smallImg, thumbnail, Size(), kMotionThumbnailScale, kMotionThumbnailScale, INTER_AREA);
+
+    // periodically run a full detection so slow drift can't accumulate unnoticed
+    if (m_MotionReference.size() != thumbnail.size() || ++m_FramesSinceFullDetection >= kMotionRefreshInterval)
+    {
+        m_MotionReference = thumbnail;
+        m_FramesSinceFullDetection = 0;
+        return MotionState::Full;
+    }
+
+    Mat diff;
+    absdiff(thumbnail, m_MotionReference, diff);
+
+    const double ratioX = static_cast<double>(smallImg.cols) / thumbnail.cols;
+    const double ratioY = static_cast<double>(smallImg.rows) / thumbnail.rows;
+    const Rect bounds(0, 0, smallImg.cols, smallImg.rows);
+    const int padding = cvRound(kMinFaceSize / scale);
+
+    for (int y = 0; y < diff.rows; y += kMotionBlockSize)
+    {
+        for (int x = 0; x < diff.cols; x += kMotionBlockSize)
+        {
+            Rect block = Rect(x, y, kMotionBlockSize, kMotionBlockSize) & Rect(0, 0, diff.cols, diff.rows);
+            if (mean(diff(block))[0] < kMotionBlockThreshold)
+            {
+                continue;
+            }
+
+            // pad by the minimum face size so a face entering the block fits in the region
+            Rect region(cvFloor(block.x * ratioX) - padding,
+                        cvFloor(block.y * ratioY) - padding,
+                        cvCeil(block.width * ratioX) + 2 * padding,
+                        cvCeil(block.height * ratioY) + 2 * padding);
+            changedRegions.push_back(region & bounds);
+        }
+    }
+
+    if (changedRegions.empty())
+    {
+        return MotionState::Static;
+    }
+
+    m_MotionReference = thumbnail;
+    _mergeRegions(changedRegions);
+
+    int changedArea = 0;
+    for (const Rect& region : changedRegions)
+    {
+        changedArea += region.area();
+    }
+
+    if (changedArea > bounds.area() * kMotionFullFrameRatio)
+    {
+        changedRegions.clear();
+        m_FramesSinceFullDetection = 0;
+        return MotionState::Full;
+    }
+
+    return MotionState::Partial;
+}
+
+void CameraItem::_mergeRegions(std::vector<Rect> &regions)
+{
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+        for (size_t i = 0; i < regions.size() && !merged; ++i)
+        {
+            for (size_t j = i + 1; j < regions.size() && !merged; ++j)
+            {
+                if ((regions[i] & regions[j]).area() > 0)
+                {
+                    regions[i] |= regions[j];
+                    regions.erase(regions.begin() + j);
+                    merged = true;
+                }
+            }
+        }
+    }
+}
+
+void CameraItem::_drawAnnotation(Mat &image, const FaceAnnotation &annotation)
+{
+    rectangle(image, annotation.face, annotation.color, 3, 8, 0);
+    rectangle(image, annotation.leftEye, annotation.color, 3, 8, 0);
+    rectangle(image, annotation.rightEye, annotation.color, 3, 8, 0);
+    if (annotation.leftEye.width > 2 && annotation.leftEye.height > 2)
+    {
+        circle(image, annotation.leftPupil, 3, 1234);
+    }
+}
+
 Point CameraItem::_getSmoothed(const Point& point)
 {
     static constexpr int listSize = 10;
@@ -553,6 +928,22 @@ void CameraItem::_scaleToFastSize(const Mat &src,Mat &dst)
 resize(src, dst, Size(kFastEyeWidth,(((float)kFastEyeWidth)/src.cols) * src.rows));
 }
 
+void CameraItem::_publishConfig()
+{
+    PipelineConfig config;
+    config.frameRate = frameRate;
+    config.videoWidth = videoWidth;
+    config.videoHeight = videoHeight;
+    config.cameraInterface = cameraInterface;
+    config.videoSource = videoSource;
+    config.detectionScale = std::min(kMaxDetectionScale, std::max(1.0, detectionScale()));
+    config.firstCascadeSource = firstCascadeSource;
+    config.secondCascadeSource = secondCascadeSource;
+    config.tiledDetection = tiledDetection;
+
+    m_Config.store(config);
+}
+
 void CameraItem::setImage()
 {
     ProcessingChainData* pData = nullptr;
@@ -8,6 +8,9 @@
 #include <thread>
 
 #include "Utils/QPropertyWrapper.h"
+#include "Utils/AtomicSnapshot.h"
+#include "Utils/MjpegCapture.h"
+#include "Utils/TiledCascade.h"
 
 #include "opencv2/opencv.hpp"
 
@@ -21,13 +24,45 @@ class CameraItem : public QQuickItem
     Q_PROPERTY(int videoWidth READ videoWidth WRITE videoWidth NOTIFY videoWidthChanged)
     Q_PROPERTY(int videoHeight READ videoHeight WRITE videoHeight NOTIFY videoHeightChanged)
     Q_PROPERTY(int cameraInterface READ cameraInterface WRITE cameraInterface NOTIFY cameraInterfaceChanged)
+    Q_PROPERTY(QString videoSource READ videoSource WRITE videoSource NOTIFY videoSourceChanged)
+    Q_PROPERTY(double detectionScale READ detectionScale WRITE detectionScale NOTIFY detectionScaleChanged)
     Q_PROPERTY(QString firstCascadeSource READ firstCascadeSource WRITE firstCascadeSource NOTIFY firstCascadeSourceChanged)
     Q_PROPERTY(QString secondCascadeSource READ secondCascadeSource WRITE secondCascadeSource NOTIFY secondCascadeSourceChanged)
+    Q_PROPERTY(bool tiledDetection READ tiledDetection WRITE tiledDetection NOTIFY tiledDetectionChanged)
+
+    enum class MotionState { Static, Partial, Full };
+
+    // everything the pipeline reads from the properties, published as one immutable version
+    struct PipelineConfig {
+        int frameRate = 0;
+        int videoWidth = 0;
+        int videoHeight = 0;
+        int cameraInterface = 0;
+        QString videoSource;
+        double detectionScale = 1.0;
+        QString firstCascadeSource;
+        QString secondCascadeSource;
+        bool tiledDetection = false;
+    };
 
     struct ProcessingChainData {
+        std::shared_ptr<const PipelineConfig> config;
+        cv::Mat compressed;
+        int decodeReduction = 1;
+        bool display = true;
         cv::Mat image;
         std::vector<cv::Rect> firstCascadeObjects, secondCascadeObjects;
         cv::Mat gray, smallImg;
+        MotionState motion = MotionState::Full;
+        std::vector<cv::Rect> changedRegions;
+        std::vector<cv::Rect> reusedFaces;
+    };
+
+    struct FaceAnnotation {
+        cv::Rect detection;
+        cv::Rect face, leftEye, rightEye;
+        cv::Point leftPupil;
+        cv::Scalar color;
     };
 
     using Concurent_queue = tbb::concurrent_bounded_queue<ProcessingChainData* >;
@@ -40,33 +75,47 @@ public:
     QPropertyWrapper<int> videoWidth;
     QPropertyWrapper<int> videoHeight;
     QPropertyWrapper<int> cameraInterface;
+    QPropertyWrapper<QString> videoSource;
+    QPropertyWrapper<double> detectionScale;
     QPropertyWrapper<QString> firstCascadeSource;
     QPropertyWrapper<QString> secondCascadeSource;
+    QPropertyWrapper<bool> tiledDetection;
 
 signals:
     void frameRateChanged();
     void videoWidthChanged();
     void videoHeightChanged();
     void cameraInterfaceChanged();
+    void videoSourceChanged();
+    void detectionScaleChanged();
     void firstCascadeSourceChanged();
     void secondCascadeSourceChanged();
+    void tiledDetectionChanged();
     void capturedImage();
 
     // QQuickItem interface
 protected:
     virtual QSGNode *updatePaintNode(QSGNode *, UpdatePaintNodeData *) override;
+    virtual void componentComplete() override;
     
 private:
     void _init();
-    bool _loadCascade(Cascade& cascade, QString url);
-    void _detectAndDrawTBB(cv::VideoCapture& m_Capture,
+    bool _loadCascade(Cascade& cascade, QString url, TiledCascade* tiledCascade = nullptr);
+    void _detectAndDrawTBB(MjpegCapture& m_Capture,
                           Concurent_queue& m_GuiQueue,
                           Cascade& cascade,
                           Cascade& nestedCascade,
-                          double scale, bool tryFlip);
+                          bool tryFlip);
+    bool _openCapture(MjpegCapture& capture, const PipelineConfig& config);
     void setImage();
+    void _publishConfig();
     cv::Rect _getSmoothed(const cv::Rect &point);
 
+    // motion gating
+    MotionState _estimateMotion(const cv::Mat &smallImg, double scale, std::vector<cv::Rect> &changedRegions);
+    void _mergeRegions(std::vector<cv::Rect> &regions);
+    void _drawAnnotation(cv::Mat &image, const FaceAnnotation &annotation);
+
     // gradient algorithms
     cv::Point _findEyeCenter(cv::Mat face, cv::Rect eye);
     cv::Mat _floodKillEdges(cv::Mat &mat);
@@ -79,16 +128,23 @@ private:
     void _scaleToFastSize(const cv::Mat &src, cv::Mat &dst);
     cv::Point _getSmoothed(const cv::Point &point);
 
-    cv::VideoCapture m_Capture;
+    MjpegCapture m_Capture;
     std::atomic<bool> m_Done;
+    std::atomic<bool> m_Displayed;
     Cascade m_FirstCascade;
     Cascade m_SecondCascade;
+    TiledCascade m_TiledCascade;
     QString m_FirstCascadeSource;
     QString m_SecondCascadeSource;
     cv::Mat m_Image;
     std::thread m_PipelineRunner;
     Concurent_queue m_GuiQueue;
+    AtomicSnapshot<PipelineConfig> m_Config;
     cv::Rect m_FacePos;
+    cv::Mat m_MotionReference;
+    int m_FramesSinceFullDetection;
+    std::vector<cv::Rect> m_LastFaces;
+    std::vector<FaceAnnotation> m_LastAnnotations;
 };
 
 #endif // CAMERAITEM_H
@@ -0,0 +1,82 @@
+#ifndef ATOMICSNAPSHOT_H
+#define ATOMICSNAPSHOT_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+// Publishes immutable versions of T. Writers copy, modify and swap in a new
+// version; readers keep whatever version they loaded for as long as they need it.
+template<class T>
+class AtomicSnapshot {
+
+public:
+    using Snapshot = std::shared_ptr<const T>;
+
+    // Per-thread cache: get() is a single atomic load unless a writer published a new version.
+    class Reader {
+    public:
+        inline explicit Reader(const AtomicSnapshot<T>& source)
+            : m_Source(source)
+            , m_Version(source.version())
+            , m_Snapshot(source.load())
+        {}
+
+        inline const Snapshot& get()
+        {
+            const std::uint64_t version = m_Source.version();
+            if (version != m_Version)
+            {
+                m_Snapshot = m_Source.load();
+                m_Version = version;
+            }
+            return m_Snapshot;
+        }
+
+    private:
+        const AtomicSnapshot<T>& m_Source;
+        std::uint64_t m_Version;
+        Snapshot m_Snapshot;
+    };
+
+    inline explicit AtomicSnapshot(const T& initialValue = T{})
+        : m_Current(std::make_shared<const T>(initialValue))
+        , m_Version(0)
+    {}
+
+    AtomicSnapshot(const AtomicSnapshot&) = delete;
+    AtomicSnapshot& operator=(const AtomicSnapshot&) = delete;
+
+    inline Snapshot load() const { return std::atomic_load_explicit(&m_Current, std::memory_order_acquire); }
+    inline std::uint64_t version() const { return m_Version.load(std::memory_order_acquire); }
+
+    inline void store(const T& value)
+    {
+        std::lock_guard<std::mutex> lock(m_WriteMutex);
+        _publish(std::make_shared<const T>(value));
+    }
+
+    template<typename Mutator>
+    inline void update(Mutator mutator)
+    {
+        std::lock_guard<std::mutex> lock(m_WriteMutex);
+        T value = *load();
+        mutator(value);
+        _publish(std::make_shared<const T>(value));
+    }
+
+private:
+    inline void _publish(Snapshot snapshot)
+    {
+        std::atomic_store_explicit(&m_Current, std::move(snapshot), std::memory_order_release);
+        m_Version.fetch_add(1, std::memory_order_release);
+    }
+
+    Snapshot m_Current;
+    std::atomic<std::uint64_t> m_Version;
+    std::mutex m_WriteMutex;
+
+};
+
+#endif // ATOMICSNAPSHOT_H
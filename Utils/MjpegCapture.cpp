@@ -0,0 +1,253 @@
+#include "MjpegCapture.h"
+
+#include <vector>
+
+// the IMREAD_REDUCED_* flags arrived in OpenCV 3.2
+#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 2)
+#define MJPEG_REDUCED_DECODE 1
+#else
+#define MJPEG_REDUCED_DECODE 0
+#endif
+
+using namespace cv;
+
+MjpegCapture::MjpegCapture()
+    : m_Passthrough(false)
+{
+}
+
+bool MjpegCapture::open(int cameraInterface)
+{
+    release();
+    if (!m_Capture.open(cameraInterface))
+    {
+        return false;
+    }
+
+    // ask for the camera's MJPEG stream undecoded, read() notices if the backend ignores it
+    m_Capture.set(CV_CAP_PROP_FOURCC, VideoWriter::fourcc('M', 'J', 'P', 'G'));
+    m_Passthrough = m_Capture.set(CV_CAP_PROP_CONVERT_RGB, 0);
+    return true;
+}
+
+bool MjpegCapture::open(const std::string &fileName)
+{
+    release();
+    m_File.open(fileName, std::ios::binary);
+    return m_File.is_open();
+}
+
+bool MjpegCapture::isOpened() const
+{
+    return m_File.is_open() || m_Capture.isOpened();
+}
+
+bool MjpegCapture::set(int propId, double value)
+{
+    if (m_File.is_open())
+    {
+        return false;
+    }
+
+    return m_Capture.set(propId, value);
+}
+
+void MjpegCapture::release()
+{
+    m_Capture.release();
+    if (m_File.is_open())
+    {
+        m_File.close();
+    }
+    m_File.clear();
+    m_Passthrough = false;
+}
+
+bool MjpegCapture::read(Mat &frame)
+{
+    if (m_File.is_open())
+    {
+        return _readFromFile(frame);
+    }
+
+    if (!m_Capture.read(frame))
+    {
+        return false;
+    }
+
+    if (m_Passthrough && !isJpeg(frame))
+    {
+        // backend doesn't pass MJPEG through, stay on decoded frames from now on
+        m_Passthrough = false;
+        m_Capture.set(CV_CAP_PROP_CONVERT_RGB, 1);
+        if (frame.type() != CV_8UC3)
+        {
+            return m_Capture.read(frame);
+        }
+    }
+
+    return true;
+}
+
+bool MjpegCapture::isJpeg(const Mat &frame)
+{
+    return frame.type() == CV_8UC1
+            && (frame.rows == 1 || frame.cols == 1)
+            && frame.total() > 4
+            && frame.isContinuous()
+            && frame.ptr()[0] == 0xFF
+            && frame.ptr()[1] == 0xD8;
+}
+
+int MjpegCapture::reductionFor(double scale)
+{
+#if MJPEG_REDUCED_DECODE
+    for (int reduction = 8; reduction > 1; reduction /= 2)
+    {
+        if (reduction <= scale)
+        {
+            return reduction;
+        }
+    }
+#else
+    // without DCT scaling a reduced decode is a full decode plus a resize, leave that to smallImg
+    (void)scale;
+#endif
+
+    return 1;
+}
+
+bool MjpegCapture::decodeLuma(const Mat &jpeg, int reduction, Mat &gray)
+{
+#if MJPEG_REDUCED_DECODE
+    // libjpeg scales in the DCT domain and skips colour conversion for these flags
+    int flags = IMREAD_GRAYSCALE;
+    switch (reduction)
+    {
+    case 2: flags = IMREAD_REDUCED_GRAYSCALE_2; break;
+    case 4: flags = IMREAD_REDUCED_GRAYSCALE_4; break;
+    case 8: flags = IMREAD_REDUCED_GRAYSCALE_8; break;
+    }
+
+    gray = imdecode(jpeg, flags);
+#else
+    gray = imdecode(jpeg, IMREAD_GRAYSCALE);
+    if (!gray.empty() && reduction > 1)
+    {
+        // same size libjpeg's scaled decode would produce
+        resize(gray, gray, Size((gray.cols + reduction - 1) / reduction, (gray.rows + reduction - 1) / reduction),
+               0, 0, INTER_AREA);
+    }
+#endif
+    return !gray.empty();
+}
+
+bool MjpegCapture::decodeColor(const Mat &jpeg, Mat &bgr)
+{
+    bgr = imdecode(jpeg, IMREAD_COLOR);
+    return !bgr.empty();
+}
+
+bool MjpegCapture::_readFromFile(Mat &frame)
+{
+    // a malformed frame is dropped by resyncing to the next start of image, only EOF ends the stream
+    while (_syncToStartOfImage())
+    {
+        if (_readSegments(frame))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool MjpegCapture::_syncToStartOfImage()
+{
+    int previous = 0;
+    int current = 0;
+    while ((current = m_File.get()) != EOF)
+    {
+        if (previous == 0xFF && current == 0xD8)
+        {
+            return true;
+        }
+        previous = current;
+    }
+
+    return false;
+}
+
+bool MjpegCapture::_readSegments(Mat &frame)
+{
+    // walk the segments rather than searching for FFD9, which can also appear in embedded thumbnails
+    std::vector<uchar> jpeg = {0xFF, 0xD8};
+    bool inScan = false;
+    int current = 0;
+    while ((current = m_File.get()) != EOF)
+    {
+        if (current != 0xFF)
+        {
+            if (!inScan)
+            {
+                return false;
+            }
+            jpeg.push_back(static_cast<uchar>(current));
+            continue;
+        }
+
+        int marker = m_File.get();
+        while (marker == 0xFF)
+        {
+            marker = m_File.get();
+        }
+        if (marker == EOF)
+        {
+            return false;
+        }
+
+        // a new start of image means the current frame was truncated, continue with the new one
+        if (marker == 0xD8)
+        {
+            jpeg.assign({0xFF, 0xD8});
+            inScan = false;
+            continue;
+        }
+
+        jpeg.push_back(0xFF);
+        jpeg.push_back(static_cast<uchar>(marker));
+
+        // stuffed zero bytes and restart markers belong to the entropy-coded data
+        if (inScan && (marker == 0x00 || (marker >= 0xD0 && marker <= 0xD7)))
+        {
+            continue;
+        }
+
+        if (marker == 0xD9)
+        {
+            frame = Mat(jpeg, true).reshape(1, 1);
+            return true;
+        }
+
+        const int high = m_File.get();
+        const int low = m_File.get();
+        const int length = (high << 8) | low;
+        if (low == EOF || length < 2)
+        {
+            return false;
+        }
+
+        jpeg.push_back(static_cast<uchar>(high));
+        jpeg.push_back(static_cast<uchar>(low));
+        const size_t offset = jpeg.size();
+        jpeg.resize(offset + length - 2);
+        if (!m_File.read(reinterpret_cast<char *>(jpeg.data() + offset), length - 2))
+        {
+            return false;
+        }
+
+        inScan = marker == 0xDA;
+    }
+
+    return false;
+}
@@ -0,0 +1,43 @@
+#ifndef MJPEGCAPTURE_H
+#define MJPEGCAPTURE_H
+
+#include <fstream>
+#include <string>
+
+#include "opencv2/opencv.hpp"
+
+// Hands out MJPEG frames still compressed, so the pipeline decides what to decode and at which size.
+// Sources are a camera (when the backend can pass MJPEG through) or a recorded .mjpeg stream of
+// concatenated JPEGs, e.g. from `ffmpeg -i cam.avi -c:v copy -f mjpeg cam.mjpeg`.
+// A camera that can't pass MJPEG through falls back to ordinary BGR frames.
+class MjpegCapture
+{
+public:
+    MjpegCapture();
+
+    bool open(int cameraInterface);
+    bool open(const std::string &fileName);
+    bool isOpened() const;
+    bool set(int propId, double value);
+    void release();
+
+    // frame is either a 1-row CV_8U JPEG buffer (see isJpeg) or a decoded BGR image
+    bool read(cv::Mat &frame);
+
+    static bool isJpeg(const cv::Mat &frame);
+    // largest JPEG DCT scaling (1, 2, 4 or 8) that doesn't go below the detection scale, always 1 before OpenCV 3.2
+    static int reductionFor(double scale);
+    static bool decodeLuma(const cv::Mat &jpeg, int reduction, cv::Mat &gray);
+    static bool decodeColor(const cv::Mat &jpeg, cv::Mat &bgr);
+
+private:
+    bool _readFromFile(cv::Mat &frame);
+    bool _syncToStartOfImage();
+    bool _readSegments(cv::Mat &frame);
+
+    cv::VideoCapture m_Capture;
+    std::ifstream m_File;
+    bool m_Passthrough;
+};
+
+#endif // MJPEGCAPTURE_H
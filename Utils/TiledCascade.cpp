@@ -0,0 +1,154 @@
+#include "TiledCascade.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "tbb/parallel_for.h"
+#include "tbb/task_arena.h"
+
+const double kTileMergeOverlap = 0.5;
+
+using namespace cv;
+
+TiledCascade::TiledCascade()
+    : m_Cascades([this] { return _createWorkerCascade(); })
+{
+}
+
+bool TiledCascade::load(const std::string &fileName)
+{
+    // only called while no detection runs, workers read their cascades again on next use
+    m_Cascades.clear();
+    m_Storage.release();
+
+    CascadeClassifier probe;
+    if (m_Storage.open(fileName, FileStorage::READ) && probe.read(m_Storage.getFirstTopLevelNode()))
+    {
+        return true;
+    }
+
+    // the old haar format is only understood by CascadeClassifier::load, convert it once
+    const std::string converted = fileName + ".converted.xml";
+    m_Storage.release();
+    const bool loaded = CascadeClassifier::convert(fileName, converted)
+            && m_Storage.open(converted, FileStorage::READ)
+            && probe.read(m_Storage.getFirstTopLevelNode());
+    std::remove(converted.c_str());
+
+    if (!loaded)
+    {
+        m_Storage.release();
+    }
+    return loaded;
+}
+
+bool TiledCascade::empty() const
+{
+    return !m_Storage.isOpened();
+}
+
+void TiledCascade::detectMultiScale(const Mat &img, std::vector<Rect> &objects,
+                                    double scaleFactor, int minNeighbors,
+                                    Size minSize, Size maxSize)
+{
+    const int tileSize = 2 * maxSize.width;
+    const int step = tileSize - maxSize.width;
+    const Rect bounds(0, 0, img.cols, img.rows);
+
+    std::vector<Rect> tiles;
+    for (int y = 0; ; y += step)
+    {
+        int tileY = std::min(y, std::max(0, img.rows - tileSize));
+        for (int x = 0; ; x += step)
+        {
+            int tileX = std::min(x, std::max(0, img.cols - tileSize));
+            tiles.push_back(Rect(tileX, tileY, tileSize, tileSize) & bounds);
+            if (tileX + tileSize >= img.cols) break;
+        }
+        if (tileY + tileSize >= img.rows) break;
+    }
+
+    // the extra job is the whole-frame pass for objects bigger than a tile can hold
+    std::vector<std::vector<Rect> > found(tiles.size() + 1);
+    tbb::parallel_for(size_t(0), found.size(), [&](size_t i)
+    {
+        // detectMultiScale runs its own TBB loop; isolation keeps a thread waiting in it from
+        // picking up another tile, which would get the same thread-local cascade mid-detection
+        tbb::this_task_arena::isolate([&]
+        {
+            CascadeClassifier& cascade = m_Cascades.local();
+            if (cascade.empty())
+            {
+                return;
+            }
+
+            if (i < tiles.size())
+            {
+                cascade.detectMultiScale(img(tiles[i]), found[i],
+                                         scaleFactor, minNeighbors, 0 | CASCADE_SCALE_IMAGE,
+                                         minSize, maxSize);
+                for (Rect& object : found[i])
+                {
+                    object += tiles[i].tl();
+                }
+            }
+            else
+            {
+                cascade.detectMultiScale(img, found[i],
+                                         scaleFactor, minNeighbors, 0 | CASCADE_SCALE_IMAGE,
+                                         maxSize);
+            }
+        });
+    });
+
+    std::vector<Rect> candidates;
+    for (const std::vector<Rect>& tileObjects : found)
+    {
+        candidates.insert(candidates.end(), tileObjects.begin(), tileObjects.end());
+    }
+
+    // an object in the overlap of several tiles is found once per tile; keep the largest of each
+    // cluster as is, so boxes aren't averaged and small objects inside bigger ones survive
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Rect& a, const Rect& b)
+    {
+        return a.area() > b.area();
+    });
+
+    objects.clear();
+    for (const Rect& candidate : candidates)
+    {
+        bool duplicate = false;
+        for (const Rect& object : objects)
+        {
+            if (intersectionOverUnion(candidate, object) > kTileMergeOverlap)
+            {
+                duplicate = true;
+                break;
+            }
+        }
+        if (!duplicate)
+        {
+            objects.push_back(candidate);
+        }
+    }
+}
+
+double TiledCascade::intersectionOverUnion(const Rect &a, const Rect &b)
+{
+    const int intersection = (a & b).area();
+    const int united = a.area() + b.area() - intersection;
+    return united > 0 ? double(intersection) / united : 0.0;
+}
+
+CascadeClassifier TiledCascade::_createWorkerCascade()
+{
+    // reading is cheap next to parsing the XML, but FileStorage isn't documented as thread safe
+    std::lock_guard<std::mutex> lock(m_StorageMutex);
+
+    CascadeClassifier cascade;
+    if (m_Storage.isOpened())
+    {
+        cascade.read(m_Storage.getFirstTopLevelNode());
+    }
+    return cascade;
+}
@@ -0,0 +1,38 @@
+#ifndef TILEDCASCADE_H
+#define TILEDCASCADE_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "opencv2/opencv.hpp"
+
+#include "tbb/enumerable_thread_specific.h"
+
+// Runs one cascade over overlapping tiles in parallel. CascadeClassifier isn't safe to share
+// between threads, so every TBB worker reads its own from the cascade parsed once in load().
+class TiledCascade
+{
+public:
+    TiledCascade();
+
+    bool load(const std::string &fileName);
+    bool empty() const;
+
+    // tiles are twice maxSize and overlap by maxSize, so every object up to maxSize fits whole
+    // in one of them; a whole-frame pass starting at maxSize catches the bigger ones
+    void detectMultiScale(const cv::Mat &img, std::vector<cv::Rect> &objects,
+                          double scaleFactor, int minNeighbors,
+                          cv::Size minSize, cv::Size maxSize);
+
+    static double intersectionOverUnion(const cv::Rect &a, const cv::Rect &b);
+
+private:
+    cv::CascadeClassifier _createWorkerCascade();
+
+    cv::FileStorage m_Storage;
+    std::mutex m_StorageMutex;
+    tbb::enumerable_thread_specific<cv::CascadeClassifier> m_Cascades;
+};
+
+#endif // TILEDCASCADE_H
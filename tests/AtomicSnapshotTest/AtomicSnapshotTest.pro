@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = tst_atomicsnapshot
+
+QT += testlib
+QT -= gui
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+HEADERS += \
+    ../../Utils/AtomicSnapshot.h
+
+SOURCES += tst_atomicsnapshot.cpp
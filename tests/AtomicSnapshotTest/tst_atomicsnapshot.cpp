@@ -0,0 +1,197 @@
+#include <QtTest>
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Utils/AtomicSnapshot.h"
+
+namespace {
+
+const int kWriters = 4;
+const int kReaders = 4;
+const int kWritesPerWriter = 20000;
+
+// every field is derived from sequence, so a torn snapshot breaks at least one of them
+struct Config {
+    int writer = 0;
+    int sequence = 0;
+    long long checksum = 0;
+    std::array<int, 16> payload = {{}};
+};
+
+Config makeConfig(int writer, int sequence)
+{
+    Config config;
+    config.writer = writer;
+    config.sequence = sequence;
+    config.checksum = static_cast<long long>(writer) * 1000003 + sequence;
+    config.payload.fill(sequence);
+    return config;
+}
+
+bool isConsistent(const Config &config)
+{
+    if (config.checksum != static_cast<long long>(config.writer) * 1000003 + config.sequence)
+        return false;
+
+    for (int value : config.payload)
+    {
+        if (value != config.sequence)
+            return false;
+    }
+    return true;
+}
+
+}
+
+class AtomicSnapshotTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void readerSeesInitialValue();
+    void readerPicksUpNewVersion();
+    void concurrentStoreAndGet();
+    void concurrentUpdateAndGet();
+};
+
+void AtomicSnapshotTest::readerSeesInitialValue()
+{
+    AtomicSnapshot<Config> snapshot(makeConfig(7, 3));
+    AtomicSnapshot<Config>::Reader reader(snapshot);
+
+    QCOMPARE(reader.get()->writer, 7);
+    QCOMPARE(reader.get()->sequence, 3);
+    QCOMPARE(snapshot.version(), std::uint64_t(0));
+}
+
+void AtomicSnapshotTest::readerPicksUpNewVersion()
+{
+    AtomicSnapshot<Config> snapshot;
+    AtomicSnapshot<Config>::Reader reader(snapshot);
+    AtomicSnapshot<Config>::Snapshot held = reader.get();
+
+    snapshot.store(makeConfig(1, 42));
+
+    QCOMPARE(reader.get()->sequence, 42);
+    QCOMPARE(snapshot.version(), std::uint64_t(1));
+    // versions already handed out stay untouched
+    QCOMPARE(held->sequence, 0);
+}
+
+void AtomicSnapshotTest::concurrentStoreAndGet()
+{
+    AtomicSnapshot<Config> snapshot(makeConfig(0, 0));
+    std::atomic<bool> done(false);
+    std::atomic<int> tornReads(0);
+    std::atomic<int> staleReads(0);
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < kReaders; ++i)
+    {
+        readers.emplace_back([&]
+        {
+            AtomicSnapshot<Config>::Reader reader(snapshot);
+            std::array<int, kWriters> lastSequence = {{}};
+            while (!done)
+            {
+                const AtomicSnapshot<Config>::Snapshot config = reader.get();
+                if (!isConsistent(*config))
+                {
+                    ++tornReads;
+                }
+                // each writer publishes increasing sequences, a reader must never go back in time
+                if (config->sequence < lastSequence[config->writer])
+                {
+                    ++staleReads;
+                }
+                lastSequence[config->writer] = config->sequence;
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (int writer = 0; writer < kWriters; ++writer)
+    {
+        writers.emplace_back([&snapshot, writer]
+        {
+            for (int sequence = 1; sequence <= kWritesPerWriter; ++sequence)
+            {
+                snapshot.store(makeConfig(writer, sequence));
+            }
+        });
+    }
+
+    for (std::thread &writer : writers)
+        writer.join();
+    done = true;
+    for (std::thread &reader : readers)
+        reader.join();
+
+    QCOMPARE(tornReads.load(), 0);
+    QCOMPARE(staleReads.load(), 0);
+    QCOMPARE(snapshot.version(), std::uint64_t(kWriters * kWritesPerWriter));
+    QVERIFY(isConsistent(*snapshot.load()));
+    QCOMPARE(snapshot.load()->sequence, kWritesPerWriter);
+}
+
+void AtomicSnapshotTest::concurrentUpdateAndGet()
+{
+    AtomicSnapshot<Config> snapshot(makeConfig(0, 0));
+    std::atomic<bool> done(false);
+    std::atomic<int> tornReads(0);
+    std::atomic<int> staleReads(0);
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < kReaders; ++i)
+    {
+        readers.emplace_back([&]
+        {
+            AtomicSnapshot<Config>::Reader reader(snapshot);
+            int lastSequence = 0;
+            while (!done)
+            {
+                const AtomicSnapshot<Config>::Snapshot config = reader.get();
+                if (!isConsistent(*config))
+                {
+                    ++tornReads;
+                }
+                if (config->sequence < lastSequence)
+                {
+                    ++staleReads;
+                }
+                lastSequence = config->sequence;
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (int writer = 0; writer < kWriters; ++writer)
+    {
+        writers.emplace_back([&snapshot]
+        {
+            for (int i = 0; i < kWritesPerWriter; ++i)
+            {
+                snapshot.update([](Config &config) { config = makeConfig(0, config.sequence + 1); });
+            }
+        });
+    }
+
+    for (std::thread &writer : writers)
+        writer.join();
+    done = true;
+    for (std::thread &reader : readers)
+        reader.join();
+
+    // no increment may be lost between concurrent read-modify-write updates
+    QCOMPARE(tornReads.load(), 0);
+    QCOMPARE(staleReads.load(), 0);
+    QCOMPARE(snapshot.load()->sequence, kWriters * kWritesPerWriter);
+    QCOMPARE(snapshot.version(), std::uint64_t(kWriters * kWritesPerWriter));
+}
+
+QTEST_APPLESS_MAIN(AtomicSnapshotTest)
+
+#include "tst_atomicsnapshot.moc"
@@ -0,0 +1,17 @@
+TEMPLATE = app
+TARGET = tst_mjpegcapture
+
+QT += testlib
+QT -= gui
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+include(../../opencv.pri)
+
+HEADERS += \
+    ../../Utils/MjpegCapture.h
+
+SOURCES += tst_mjpegcapture.cpp \
+    ../../Utils/MjpegCapture.cpp
@@ -0,0 +1,124 @@
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "Utils/MjpegCapture.h"
+
+class MjpegCaptureTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void readsEveryIntactFrame();
+    void decodeLumaReducesSize_data();
+    void decodeLumaReducesSize();
+
+private:
+    QString _writeStream(const QByteArray &stream);
+
+    QTemporaryDir m_Dir;
+    QByteArray m_Jpeg;
+};
+
+void MjpegCaptureTest::initTestCase()
+{
+    QFile file(QFINDTESTDATA("../../assets/cat.jpg"));
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    m_Jpeg = file.readAll();
+
+    QVERIFY(m_Dir.isValid());
+    QVERIFY(m_Jpeg.startsWith("\xFF\xD8"));
+    QVERIFY(m_Jpeg.endsWith("\xFF\xD9"));
+}
+
+void MjpegCaptureTest::readsEveryIntactFrame()
+{
+    const QByteArray startOfImage("\xFF\xD8", 2);
+
+    // cut inside the entropy-coded data, so the next frame's FFD8 shows up mid-scan
+    const QByteArray truncated = m_Jpeg.left(m_Jpeg.size() - 200);
+    QVERIFY(truncated.indexOf(QByteArray("\xFF\xDA", 2)) > 0);
+
+    // an APP1 segment carrying a whole JPEG, its FFD8...FFD9 must not end the outer frame
+    QByteArray thumbnail = startOfImage;
+    thumbnail.append("\xFF\xE1", 2);
+    thumbnail.append(static_cast<char>(((m_Jpeg.size() + 2) >> 8) & 0xFF));
+    thumbnail.append(static_cast<char>((m_Jpeg.size() + 2) & 0xFF));
+    thumbnail.append(m_Jpeg);
+    thumbnail.append(m_Jpeg.mid(2));
+
+    // APP0 with a length below the two length bytes themselves
+    QByteArray badLength = startOfImage;
+    badLength.append("\xFF\xE0\x00\x01", 4);
+    badLength.append(m_Jpeg.mid(2));
+
+    QByteArray stream;
+    stream.append(m_Jpeg);
+    stream.append(truncated);
+    stream.append(m_Jpeg);
+    stream.append("junk\x00\x01\xFF", 7);
+    stream.append(thumbnail);
+    stream.append(badLength);
+    stream.append(m_Jpeg);
+
+    MjpegCapture capture;
+    QVERIFY(capture.open(_writeStream(stream).toStdString()));
+
+    QList<int> frameSizes;
+    cv::Mat frame;
+    while (capture.read(frame))
+    {
+        QVERIFY(MjpegCapture::isJpeg(frame));
+
+        cv::Mat bgr;
+        QVERIFY(MjpegCapture::decodeColor(frame, bgr));
+        frameSizes << static_cast<int>(frame.total());
+    }
+
+    const QList<int> expected = QList<int>() << m_Jpeg.size()
+                                             << m_Jpeg.size()
+                                             << thumbnail.size()
+                                             << m_Jpeg.size();
+    QCOMPARE(frameSizes, expected);
+}
+
+void MjpegCaptureTest::decodeLumaReducesSize_data()
+{
+    QTest::addColumn<int>("reduction");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("1/2") << 2;
+    QTest::newRow("1/4") << 4;
+    QTest::newRow("1/8") << 8;
+}
+
+void MjpegCaptureTest::decodeLumaReducesSize()
+{
+    QFETCH(int, reduction);
+
+    const cv::Mat jpeg(1, m_Jpeg.size(), CV_8UC1, const_cast<char *>(m_Jpeg.constData()));
+
+    cv::Mat bgr;
+    QVERIFY(MjpegCapture::decodeColor(jpeg, bgr));
+
+    cv::Mat gray;
+    QVERIFY(MjpegCapture::decodeLuma(jpeg, reduction, gray));
+    QCOMPARE(gray.type(), CV_8UC1);
+    QCOMPARE(gray.cols, (bgr.cols + reduction - 1) / reduction);
+    QCOMPARE(gray.rows, (bgr.rows + reduction - 1) / reduction);
+}
+
+QString MjpegCaptureTest::_writeStream(const QByteArray &stream)
+{
+    const QString fileName = m_Dir.filePath(QStringLiteral("stream.mjpeg"));
+    QFile file(fileName);
+    if (file.open(QIODevice::WriteOnly))
+    {
+        file.write(stream);
+    }
+    return fileName;
+}
+
+QTEST_APPLESS_MAIN(MjpegCaptureTest)
+
+#include "tst_mjpegcapture.moc"
@@ -0,0 +1,17 @@
+TEMPLATE = app
+TARGET = tst_tiledcascade
+
+QT += testlib
+QT -= gui
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+include(../../opencv.pri)
+
+HEADERS += \
+    ../../Utils/TiledCascade.h
+
+SOURCES += tst_tiledcascade.cpp \
+    ../../Utils/TiledCascade.cpp
@@ -0,0 +1,102 @@
+#include <QtTest>
+
+#include "Utils/TiledCascade.h"
+
+const double kMinMatchOverlap = 0.5;
+const double kMinMatchedRatio = 0.8;
+
+class TiledCascadeTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void matchesFullFrameDetection_data();
+    void matchesFullFrameDetection();
+
+private:
+    static int _countMatched(const std::vector<cv::Rect> &objects, const std::vector<cv::Rect> &reference);
+
+    cv::Mat m_Image;
+};
+
+void TiledCascadeTest::initTestCase()
+{
+    const cv::Mat cat = cv::imread(QFINDTESTDATA("../../assets/cat.jpg").toStdString(), cv::IMREAD_GRAYSCALE);
+    QVERIFY(!cat.empty());
+
+    // a frame far bigger than one tile, with copies of every feature lying across tile borders
+    cv::Mat mosaic;
+    cv::repeat(cat, 3, 4, mosaic);
+    cv::resize(mosaic, m_Image, cv::Size(), 1.5, 1.5, cv::INTER_LINEAR);
+    cv::equalizeHist(m_Image, m_Image);
+}
+
+void TiledCascadeTest::matchesFullFrameDetection_data()
+{
+    QTest::addColumn<QString>("cascadeFile");
+    QTest::addColumn<int>("minSize");
+    QTest::addColumn<int>("maxSize");
+
+    QTest::newRow("frontal face") << QFINDTESTDATA("../../cascades/haarcascade_frontalface_alt.xml") << 30 << 80;
+    QTest::newRow("eye") << QFINDTESTDATA("../../cascades/haarcascade_eye.xml") << 20 << 60;
+}
+
+void TiledCascadeTest::matchesFullFrameDetection()
+{
+    QFETCH(QString, cascadeFile);
+    QFETCH(int, minSize);
+    QFETCH(int, maxSize);
+
+    cv::CascadeClassifier cascade;
+    QVERIFY(cascade.load(cascadeFile.toStdString()));
+    TiledCascade tiledCascade;
+    QVERIFY(tiledCascade.load(cascadeFile.toStdString()));
+    QVERIFY(!tiledCascade.empty());
+
+    std::vector<cv::Rect> reference;
+    cascade.detectMultiScale(m_Image, reference,
+                             1.05, 3, 0 | cv::CASCADE_SCALE_IMAGE,
+                             cv::Size(minSize, minSize));
+    if (reference.empty())
+    {
+        QSKIP("the full-frame pass found nothing to compare against");
+    }
+
+    std::vector<cv::Rect> tiled;
+    tiledCascade.detectMultiScale(m_Image, tiled, 1.05, 3,
+                                  cv::Size(minSize, minSize),
+                                  cv::Size(maxSize, maxSize));
+
+    // window positions differ slightly between a tile and the whole frame, so neighbour counts
+    // near the threshold can flip; most objects must still be found by both
+    const int found = _countMatched(reference, tiled);
+    const int confirmed = _countMatched(tiled, reference);
+    const QByteArray counts = QByteArray("full-frame ") + QByteArray::number(int(reference.size()))
+            + ", tiled " + QByteArray::number(int(tiled.size()))
+            + ", found " + QByteArray::number(found)
+            + ", confirmed " + QByteArray::number(confirmed);
+    QVERIFY2(found >= kMinMatchedRatio * reference.size(), counts.constData());
+    QVERIFY2(confirmed >= kMinMatchedRatio * tiled.size(), counts.constData());
+}
+
+int TiledCascadeTest::_countMatched(const std::vector<cv::Rect> &objects, const std::vector<cv::Rect> &reference)
+{
+    int matched = 0;
+    for (const cv::Rect &object : objects)
+    {
+        for (const cv::Rect &candidate : reference)
+        {
+            if (TiledCascade::intersectionOverUnion(object, candidate) >= kMinMatchOverlap)
+            {
+                ++matched;
+                break;
+            }
+        }
+    }
+    return matched;
+}
+
+QTEST_APPLESS_MAIN(TiledCascadeTest)
+
+#include "tst_tiledcascade.moc"